@@ -6,19 +6,24 @@
 #define BREAKPOINT_HPP
 
 #include <iostream>
+#include <string>
+#include <utility>
 #include <sys/ptrace.h>
 
 class Breakpoint {
     public:
         Breakpoint() = default;
 
-        Breakpoint(pid_t pid, std::intptr_t addr)
-        : m_pid(pid), m_addr(addr), m_enabled(false), m_saved_data{} {}
+        Breakpoint(pid_t pid, std::intptr_t addr, std::string symbol = {})
+        : m_pid(pid), m_addr(addr), m_enabled(false), m_saved_data{}, m_symbol(std::move(symbol)) {}
 
         bool is_enabled() const { return m_enabled; }
 
         std::intptr_t get_address() const { return m_addr; }
 
+        /* name it was set on, empty for a breakpoint set by address */
+        const std::string& get_symbol() const { return m_symbol; }
+
         void enable() {
             //peek at data
             auto data = ptrace(PTRACE_PEEKDATA, m_pid, m_addr, nullptr);
@@ -48,6 +53,7 @@ class Breakpoint {
         std::intptr_t m_addr;
         bool m_enabled;
         uint8_t m_saved_data;
+        std::string m_symbol;
 
 };
 
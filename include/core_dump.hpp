@@ -0,0 +1,491 @@
+//
+// Created by Madhav Ramesh on 10/18/26.
+//
+
+#ifndef CORE_DUMP_HPP
+#define CORE_DUMP_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/procfs.h>
+#include <sys/ptrace.h>
+#include <sys/user.h>
+
+#include <elf++.hh>
+
+#include "memory_map.hpp"
+
+/*
+ * Writes an ELF core of a ptrace-stopped inferior, in the same shape the kernel produces:
+ *   [Ehdr][PT_NOTE phdr][PT_LOAD phdr * n][notes][pad to page][segment contents...]
+ * Contents are copied with process_vm_readv on a pool of threads, and all-zero pages are
+ * never written so they end up as holes in a sparse file.
+ */
+class CoreDump {
+    public:
+        explicit CoreDump(pid_t pid) : m_pid(pid), m_page_size(sysconf(_SC_PAGESIZE)) {
+            std::ifstream filter("/proc/" + std::to_string(m_pid) + "/coredump_filter");
+            filter >> std::hex >> m_filter;
+        }
+
+        struct stats {
+            uint64_t segments;
+            uint64_t bytes_dumped;
+            uint64_t bytes_written;
+        };
+
+        stats write(const std::string& path) {
+            auto regions = read_regions();
+            if (regions.size() + 1 >= PN_XNUM) {
+                throw std::runtime_error("Too many mappings for a core file");
+            }
+
+            auto notes = build_notes(regions);
+
+            const uint64_t phnum = regions.size() + 1;
+            const uint64_t notes_offset = sizeof(Elf64_Ehdr) + phnum * sizeof(Elf64_Phdr);
+            uint64_t offset = align_up(notes_offset + notes.size());
+
+            std::vector<Elf64_Phdr> phdrs;
+            phdrs.push_back(Elf64_Phdr {PT_NOTE, 0, notes_offset, 0, 0, notes.size(), 0, 4});
+
+            std::vector<chunk> chunks;
+            stats result {phnum, 0, 0};
+
+            for (auto& region : regions) {
+                Elf64_Phdr phdr {};
+                phdr.p_type = PT_LOAD;
+                phdr.p_flags = (region.readable ? PF_R : 0) | (region.writable ? PF_W : 0)
+                             | (region.executable ? PF_X : 0);
+                phdr.p_offset = offset;
+                phdr.p_vaddr = region.start;
+                phdr.p_memsz = region.size();
+                phdr.p_align = m_page_size;
+
+                if (auto size = dump_size(region)) {
+                    phdr.p_filesz = size;
+                    for (uint64_t at = 0; at < size; at += chunk_size) {
+                        chunks.push_back({region.start + at, std::min(chunk_size, size - at), offset + at});
+                    }
+                    offset += size;
+                    result.bytes_dumped += size;
+                }
+                phdrs.push_back(phdr);
+            }
+
+            int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+            if (fd < 0) {
+                throw std::runtime_error("Unable to open " + path + ": " + std::strerror(errno));
+            }
+
+            auto ehdr = build_header(phnum);
+            bool ok = pwrite_all(fd, &ehdr, sizeof(ehdr), 0)
+                   && pwrite_all(fd, phdrs.data(), phdrs.size() * sizeof(Elf64_Phdr), sizeof(ehdr))
+                   && pwrite_all(fd, notes.data(), notes.size(), notes_offset)
+                   //size the file up front, anything not written stays a hole
+                   && ftruncate(fd, offset) == 0;
+
+            int error = ok ? copy_segments(fd, chunks, result.bytes_written) : errno;
+            close(fd);
+
+            if (error != 0) {
+                throw std::runtime_error("Failed writing " + path + ": " + std::strerror(error));
+            }
+            return result;
+        }
+
+    private:
+        pid_t m_pid;
+        uint64_t m_page_size;
+        /* /proc/<pid>/coredump_filter, the kernel default if it can't be read */
+        uint64_t m_filter = filter_default;
+
+        /* coredump_filter bits, see core(5) */
+        static constexpr uint64_t filter_anon_private = 1 << 0;
+        static constexpr uint64_t filter_anon_shared = 1 << 1;
+        static constexpr uint64_t filter_file_private = 1 << 2;
+        static constexpr uint64_t filter_file_shared = 1 << 3;
+        static constexpr uint64_t filter_elf_headers = 1 << 4;
+        static constexpr uint64_t filter_hugetlb_private = 1 << 5;
+        static constexpr uint64_t filter_hugetlb_shared = 1 << 6;
+        static constexpr uint64_t filter_default = 0x33;
+
+        static constexpr uint64_t chunk_size = 4 << 20;
+
+        /* piece of a PT_LOAD segment handed to one worker */
+        struct chunk {
+            uint64_t addr;
+            uint64_t len;
+            uint64_t file_offset;
+        };
+
+        uint64_t align_up(uint64_t v) const {
+            return (v + m_page_size - 1) & ~(m_page_size - 1);
+        }
+
+        std::vector<sandbg::memory_region> read_regions() const {
+            auto regions = sandbg::read_memory_map(m_pid, true);
+            //[vsyscall] lives above TASK_SIZE and can't be read through the process
+            regions.erase(std::remove_if(regions.begin(), regions.end(),
+                                         [](auto&& r) { return r.path == "[vsyscall]"; }),
+                          regions.end());
+            return regions;
+        }
+
+        /* how much of a mapping goes into the file, following the kernel's vma_dump_size():
+           MADV_DONTDUMP and device mappings never, everything else as coredump_filter says */
+        uint64_t dump_size(const sandbg::memory_region& region) const {
+            if (!region.readable || region.dont_dump || region.io || region.path.starts_with("[vvar")) {
+                return 0;
+            }
+
+            const auto filtered = [this](uint64_t bit) { return (m_filter & bit) != 0; };
+            if (region.hugetlb) {
+                return filtered(region.shared ? filter_hugetlb_shared : filter_hugetlb_private) ? region.size() : 0;
+            }
+            if (region.shared) {
+                //shmem/memfd/SysV segments have no file to recover them from, like the kernel treat them as anon
+                bool anon = !region.is_file_backed() || region.path.starts_with("/SYSV")
+                            || region.path.starts_with("/dev/zero") || region.path.ends_with(" (deleted)");
+                return filtered(anon ? filter_anon_shared : filter_file_shared) ? region.size() : 0;
+            }
+            //private file mappings with COW'd pages (.data, RELRO) count as anon
+            if (!region.is_file_backed() || region.anonymous != 0) {
+                return filtered(filter_anon_private) ? region.size() : 0;
+            }
+            if (filtered(filter_file_private)) {
+                return region.size();
+            }
+
+            //first page of a mapped ELF so the build-id can be matched up offline
+            if (filtered(filter_elf_headers) && region.offset == 0) {
+                char magic[SELFMAG];
+                if (sandbg::read_memory_block(m_pid, region.start, magic, SELFMAG) == SELFMAG
+                    && std::memcmp(magic, ELFMAG, SELFMAG) == 0) {
+                    return m_page_size;
+                }
+            }
+            return 0;
+        }
+
+        Elf64_Ehdr build_header(uint64_t phnum) const {
+            Elf64_Ehdr ehdr {};
+            std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+            ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+            ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+            ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+            ehdr.e_ident[EI_OSABI] = ELFOSABI_NONE;
+            ehdr.e_type = ET_CORE;
+            ehdr.e_machine = EM_X86_64;
+            ehdr.e_version = EV_CURRENT;
+            ehdr.e_phoff = sizeof(Elf64_Ehdr);
+            ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+            ehdr.e_phentsize = sizeof(Elf64_Phdr);
+            ehdr.e_phnum = phnum;
+            ehdr.e_shentsize = sizeof(Elf64_Shdr);
+            return ehdr;
+        }
+
+        static void add_note(std::vector<char>& out, const char* name, uint32_t type, const void* desc, std::size_t size) {
+            const auto pad4 = [](std::size_t v) { return (v + 3) & ~std::size_t{3}; };
+            Elf64_Nhdr nhdr {static_cast<Elf64_Word>(std::strlen(name) + 1), static_cast<Elf64_Word>(size), type};
+
+            auto at = out.size();
+            out.resize(at + sizeof(nhdr) + pad4(nhdr.n_namesz) + pad4(size));
+            std::memcpy(&out[at], &nhdr, sizeof(nhdr));
+            std::memcpy(&out[at + sizeof(nhdr)], name, nhdr.n_namesz);
+            std::memcpy(&out[at + sizeof(nhdr) + pad4(nhdr.n_namesz)], desc, size);
+        }
+
+        std::string read_proc_file(const std::string& name) const {
+            std::ifstream file("/proc/" + std::to_string(m_pid) + "/" + name, std::ios::binary);
+            return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        }
+
+        std::vector<char> build_notes(const std::vector<sandbg::memory_region>& regions) const {
+            std::vector<char> notes;
+
+            siginfo_t siginfo {};
+            ptrace(PTRACE_GETSIGINFO, m_pid, nullptr, &siginfo);
+
+            elf_prstatus prstatus {};
+            prstatus.pr_info.si_signo = siginfo.si_signo;
+            prstatus.pr_cursig = siginfo.si_signo;
+            prstatus.pr_pid = m_pid;
+            prstatus.pr_ppid = getpid();
+            prstatus.pr_pgrp = getpgid(m_pid);
+            prstatus.pr_sid = getsid(m_pid);
+            //elf_gregset_t has the same layout as user_regs_struct on x86_64
+            ptrace(PTRACE_GETREGS, m_pid, nullptr, &prstatus.pr_reg);
+            prstatus.pr_fpvalid = 1;
+            add_note(notes, "CORE", NT_PRSTATUS, &prstatus, sizeof(prstatus));
+
+            elf_prpsinfo prpsinfo {};
+            prpsinfo.pr_sname = 't';
+            prpsinfo.pr_state = 3;
+            prpsinfo.pr_pid = m_pid;
+            prpsinfo.pr_ppid = getpid();
+            prpsinfo.pr_pgrp = prstatus.pr_pgrp;
+            prpsinfo.pr_sid = prstatus.pr_sid;
+            prpsinfo.pr_uid = getuid();
+            prpsinfo.pr_gid = getgid();
+            auto comm = read_proc_file("comm");
+            std::strncpy(prpsinfo.pr_fname, comm.substr(0, comm.find('\n')).c_str(), sizeof(prpsinfo.pr_fname) - 1);
+            auto cmdline = read_proc_file("cmdline");
+            std::replace(cmdline.begin(), cmdline.end(), '\0', ' ');
+            std::strncpy(prpsinfo.pr_psargs, cmdline.c_str(), sizeof(prpsinfo.pr_psargs) - 1);
+            add_note(notes, "CORE", NT_PRPSINFO, &prpsinfo, sizeof(prpsinfo));
+
+            add_note(notes, "CORE", NT_SIGINFO, &siginfo, sizeof(siginfo));
+
+            auto auxv = read_proc_file("auxv");
+            add_note(notes, "CORE", NT_AUXV, auxv.data(), auxv.size());
+
+            auto file_note = build_file_note(regions);
+            add_note(notes, "CORE", NT_FILE, file_note.data(), file_note.size());
+
+            user_fpregs_struct fpregs {};
+            ptrace(PTRACE_GETFPREGS, m_pid, nullptr, &fpregs);
+            add_note(notes, "CORE", NT_FPREGSET, &fpregs, sizeof(fpregs));
+
+            return notes;
+        }
+
+        /* count, page size, {start, end, file offset in pages} * count, then the names */
+        std::vector<char> build_file_note(const std::vector<sandbg::memory_region>& regions) const {
+            std::vector<uint64_t> header {0, m_page_size};
+            std::string names;
+
+            for (auto& region : regions) {
+                if (region.is_file_backed()) {
+                    header.insert(header.end(), {region.start, region.end, region.offset / m_page_size});
+                    names.append(region.path).push_back('\0');
+                    ++header[0];
+                }
+            }
+
+            std::vector<char> out(header.size() * sizeof(uint64_t) + names.size());
+            std::memcpy(out.data(), header.data(), header.size() * sizeof(uint64_t));
+            std::memcpy(out.data() + header.size() * sizeof(uint64_t), names.data(), names.size());
+            return out;
+        }
+
+        static bool pwrite_all(int fd, const void* buf, std::size_t len, uint64_t offset) {
+            std::size_t done = 0;
+            while (done < len) {
+                auto n = pwrite(fd, static_cast<const char*>(buf) + done, len - done, offset + done);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+                }
+                done += n;
+            }
+            return true;
+        }
+
+        /* workers pull chunks off a shared index, only runs of non-zero pages get written.
+           returns the errno of the first failed write, errno being per thread */
+        int copy_segments(int fd, const std::vector<chunk>& chunks, uint64_t& bytes_written) const {
+            std::atomic<std::size_t> next {0};
+            std::atomic<uint64_t> written {0};
+            std::atomic<int> error {0};
+
+            const auto fail = [&error] {
+                int expected = 0;
+                error.compare_exchange_strong(expected, errno);
+            };
+
+            auto worker = [&] {
+                std::vector<char> buf(chunk_size);
+                const std::vector<char> zero_page(m_page_size);
+
+                for (auto i = next++; i < chunks.size() && error == 0; i = next++) {
+                    const chunk& c = chunks[i];
+                    uint64_t at = 0;
+
+                    while (at < c.len) {
+                        auto n = sandbg::read_memory_block(m_pid, c.addr + at, buf.data() + at, c.len - at);
+                        //page we can't read (e.g. guard page), leave it as a hole and carry on
+                        auto end = at + n;
+                        if (n == 0) {
+                            at = std::min(align_up(c.addr + at + 1) - c.addr, c.len);
+                            continue;
+                        }
+
+                        uint64_t run = at;
+                        for (uint64_t page = at; page < end; page += m_page_size) {
+                            auto len = std::min(m_page_size, end - page);
+                            if (std::memcmp(buf.data() + page, zero_page.data(), len) == 0) {
+                                if (run < page && !flush(fd, buf, c, run, page, written)) fail();
+                                run = page + len;
+                            }
+                        }
+                        if (run < end && !flush(fd, buf, c, run, end, written)) fail();
+                        at = end;
+                    }
+                }
+            };
+
+            auto n_threads = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, std::max<std::size_t>(chunks.size(), 1));
+            std::vector<std::thread> threads;
+            for (std::size_t i = 0; i < n_threads; ++i) {
+                threads.emplace_back(worker);
+            }
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            bytes_written = written;
+            return error;
+        }
+
+        static bool flush(int fd, const std::vector<char>& buf, const chunk& c, uint64_t from, uint64_t to,
+                          std::atomic<uint64_t>& written) {
+            written += to - from;
+            return pwrite_all(fd, buf.data() + from, to - from, c.file_offset + from);
+        }
+};
+
+/*
+ * Reads a core back (ours or the kernel's) for offline inspection: registers from NT_PRSTATUS,
+ * mapped files from NT_FILE and memory from the PT_LOAD segments. Pages that were left out of
+ * the core because they're file-backed are read from the mapped file instead.
+ */
+class CoreFile {
+    public:
+        struct mapped_file {
+            uint64_t start;
+            uint64_t end;
+            uint64_t offset;
+            std::string path;
+        };
+
+        explicit CoreFile(const elf::elf& core) : m_core(core) {
+            if (m_core.get_hdr().type != elf::et::core) {
+                throw std::invalid_argument("Not a core file");
+            }
+            for (auto& seg : m_core.segments()) {
+                auto& hdr = seg.get_hdr();
+                if (hdr.type == elf::pt::note) {
+                    parse_notes(static_cast<const char*>(seg.data()), hdr.filesz);
+                }
+                else if (hdr.type == elf::pt::load) {
+                    m_loads.push_back(seg);
+                }
+            }
+        }
+
+        pid_t get_pid() const { return m_pid; }
+
+        const user_regs_struct& get_registers() const { return m_regs; }
+
+        const std::vector<mapped_file>& get_files() const { return m_files; }
+
+        uint64_t get_auxv(uint64_t type) const {
+            auto it = m_auxv.find(type);
+            return it == m_auxv.end() ? 0 : it->second;
+        }
+
+        /* nullopt when the address wasn't mapped or its contents weren't dumped */
+        std::optional<uint64_t> read_memory(uint64_t addr) const {
+            uint64_t data = 0;
+            for (auto& seg : m_loads) {
+                auto& hdr = seg.get_hdr();
+                if (addr >= hdr.vaddr && addr + sizeof(data) <= hdr.vaddr + hdr.filesz) {
+                    std::memcpy(&data, static_cast<const char*>(seg.data()) + (addr - hdr.vaddr), sizeof(data));
+                    return data;
+                }
+            }
+
+            for (auto& file : m_files) {
+                if (addr >= file.start && addr + sizeof(data) <= file.end) {
+                    int fd = open(file.path.c_str(), O_RDONLY);
+                    if (fd < 0) {
+                        return std::nullopt;
+                    }
+                    auto n = pread(fd, &data, sizeof(data), file.offset + (addr - file.start));
+                    close(fd);
+                    return n == sizeof(data) ? std::optional<uint64_t>{data} : std::nullopt;
+                }
+            }
+            return std::nullopt;
+        }
+
+    private:
+        elf::elf m_core;
+        std::vector<elf::segment> m_loads;
+        pid_t m_pid = 0;
+        user_regs_struct m_regs {};
+        std::unordered_map<uint64_t, uint64_t> m_auxv;
+        std::vector<mapped_file> m_files;
+
+        void parse_notes(const char* data, uint64_t size) {
+            const auto pad4 = [](uint64_t v) { return (v + 3) & ~uint64_t{3}; };
+            uint64_t at = 0;
+
+            while (at + sizeof(Elf64_Nhdr) <= size) {
+                Elf64_Nhdr nhdr;
+                std::memcpy(&nhdr, data + at, sizeof(nhdr));
+                const char* desc = data + at + sizeof(nhdr) + pad4(nhdr.n_namesz);
+                at += sizeof(nhdr) + pad4(nhdr.n_namesz) + pad4(nhdr.n_descsz);
+                if (at > size) {
+                    break;
+                }
+
+                if (nhdr.n_type == NT_PRSTATUS && nhdr.n_descsz >= sizeof(elf_prstatus)) {
+                    //one per thread, the first one is the thread that stopped
+                    if (m_pid == 0) {
+                        elf_prstatus prstatus;
+                        std::memcpy(&prstatus, desc, sizeof(prstatus));
+                        m_pid = prstatus.pr_pid;
+                        std::memcpy(&m_regs, &prstatus.pr_reg, sizeof(m_regs));
+                    }
+                }
+                else if (nhdr.n_type == NT_AUXV) {
+                    for (uint64_t i = 0; i + 2 * sizeof(uint64_t) <= nhdr.n_descsz; i += 2 * sizeof(uint64_t)) {
+                        uint64_t entry[2];
+                        std::memcpy(entry, desc + i, sizeof(entry));
+                        m_auxv[entry[0]] = entry[1];
+                    }
+                }
+                else if (nhdr.n_type == NT_FILE) {
+                    parse_file_note(desc, nhdr.n_descsz);
+                }
+            }
+        }
+
+        /* count, page size, {start, end, file offset in pages} * count, then the names */
+        void parse_file_note(const char* desc, uint64_t size) {
+            uint64_t header[2];
+            if (size < sizeof(header)) {
+                return;
+            }
+            std::memcpy(header, desc, sizeof(header));
+            auto [count, page_size] = header;
+
+            const char* name = desc + sizeof(header) + count * 3 * sizeof(uint64_t);
+            const char* end = desc + size;
+            for (uint64_t i = 0; i < count && name < end; ++i) {
+                uint64_t entry[3];
+                std::memcpy(entry, desc + sizeof(header) + i * sizeof(entry), sizeof(entry));
+                std::string path {name, std::find(name, end, '\0')};
+                name += path.size() + 1;
+                m_files.push_back({entry[0], entry[1], entry[2] * page_size, path});
+            }
+        }
+};
+
+#endif //CORE_DUMP_HPP
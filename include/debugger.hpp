@@ -5,19 +5,33 @@
 #ifndef DEBUGGER_HPP
 #define DEBUGGER_HPP
 
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
+#include <map>
+#include <optional>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
 #include <fstream>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
 
 #include <dwarf++.hh>
 #include <elf++.hh>
 #include <linenoise.h>
 
 #include "breakpoint.hpp"
+#include "core_dump.hpp"
+#include "memory_map.hpp"
+#include "module.hpp"
 
 #include "helpers.hpp"
 #include "registers.hpp"
@@ -37,26 +51,86 @@ class Debugger {
             m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_elf)};
         }
 
+        /* offline, inspecting a core of program_name. the core is m_elf, the executable only
+           supplies DWARF and symbols and there's no live process behind m_pid */
+        Debugger(std::string program_name, const std::string& core_name)
+        : m_program_name(std::move(program_name)), m_pid(0) {
+            auto fd = open(m_program_name.c_str(), O_RDONLY);
+
+            if (fd < 0) {
+                std::cerr << "Invalid program name\n";
+                throw std::invalid_argument("Invalid program name");
+            }
+
+            elf::elf exe {elf::create_mmap_loader(fd)};
+            m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(exe)};
+
+            fd = open(core_name.c_str(), O_RDONLY);
+            if (fd < 0) {
+                std::cerr << "Invalid core file\n";
+                throw std::invalid_argument("Invalid core file");
+            }
+            m_elf = elf::elf{elf::create_mmap_loader(fd)};
+            m_core.emplace(m_elf);
+
+            //no /proc/<pid>/maps to look at, AT_ENTRY gives the PIE load bias instead
+            if (exe.get_hdr().type == elf::et::dyn) {
+                m_load_address = m_core->get_auxv(AT_ENTRY) - exe.get_hdr().entry;
+            }
+            initialize_core_modules(exe);
+        }
+
         void run() {
-            wait_for_signal();
+            if (m_core) {
+                std::cout << "Core of pid " << std::dec << m_core->get_pid() << ", stopped at "
+                          << std::hex << get_pc() << std::dec << "\n";
+                print_location(get_pc());
+                event_loop();
+                return;
+            }
+            wait_for_exec();
             initialize_load_address();
+            initialize_modules();
+            assign_module_ranges(m_modules);
+            event_loop();
+        }
 
-            char* line = nullptr;
-            while((line = linenoise("sandbg> ")) != nullptr ) {
-                handle_command(line);
-                linenoiseHistoryAdd(line);
-                linenoiseFree(line);
+        /* resolves in link_map order like the dynamic linker would, global/weak definitions first and
+           local (static) ones only if nothing exports the name. deferred until a matching library gets loaded */
+        void set_breakpoint_at_symbol(const std::string& name) {
+            for (bool include_local : {false, true}) {
+                for (auto& path : m_module_order) {
+                    if (auto addr = m_modules.at(path).find_symbol(name, include_local)) {
+                        set_breakpoint_at_address(*addr, name);
+                        return;
+                    }
+                }
             }
+            std::cout << "Breakpoint on " << name << " pending until a library defining it is loaded\n";
+            m_pending_breakpoints.push_back(name);
         }
 
-        void set_breakpoint_at_address(std::intptr_t addr) {
+        void set_breakpoint_at_address(std::intptr_t addr, const std::string& symbol = {}) {
             std::cout << "Set breakpoint at addr 0x: " << std::hex << addr << "\n";
-            Breakpoint breakpoint {m_pid, addr};
+            Breakpoint breakpoint {m_pid, addr, symbol};
             breakpoint.enable();
             m_breakpoints[addr] = breakpoint;
         }
 
         uint64_t read_memory (uint64_t addr) const {
+            if (m_core) {
+                auto data = m_core->read_memory(addr);
+                if (!data) {
+                    std::cerr << "Address not in core file\n";
+                }
+                return data.value_or(0);
+            }
+            //PEEKDATA needs a stopped tracee, process_vm_readv doesn't
+            if (m_running) {
+                uint64_t data = 0;
+                sandbg::read_memory_block(m_pid, addr, &data, sizeof(data));
+                return data;
+            }
             return ptrace(PTRACE_PEEKDATA, m_pid, addr, nullptr);
         }
 
@@ -68,21 +142,435 @@ class Debugger {
         std::string m_program_name;
         pid_t m_pid;
         std::unordered_map<std::intptr_t, Breakpoint> m_breakpoints;
-        uint64_t m_load_address;
+        uint64_t m_load_address = 0;
 
         dwarf::dwarf m_dwarf;
+        /* the executable, or the core file when inspecting one */
         elf::elf m_elf;
+        std::optional<CoreFile> m_core;
+
+        /* everything in the link_map keyed by path, the executable under m_program_name */
+        std::map<std::string, Module> m_modules;
+        /* m_modules' keys in link_map (symbol search) order */
+        std::vector<std::string> m_module_order;
+        std::vector<std::string> m_pending_breakpoints;
+        /* _r_debug and _dl_debug_state in ld.so, 0 for static executables */
+        uint64_t m_r_debug_address = 0;
+        uint64_t m_rendezvous_address = 0;
+        bool m_at_rendezvous = false;
+
+        /* resumed and not seen stopping yet */
+        bool m_running = false;
+        /* plain continue holds the prompt until the next stop, continue & hands it back straight away */
+        bool m_foreground = false;
+        bool m_exited = false;
+        /* PTRACE_INTERRUPT sent and nothing else has stopped the inferior since. a PTRACE_EVENT_STOP
+           arriving without this set is an interrupt that lost the race to another stop */
+        bool m_interrupt_wanted = false;
+        bool m_stale_interrupt = false;
+
+        /* linenoise multiplexed editing, or plain line buffering when stdin isn't a terminal */
+        bool m_tty = isatty(STDIN_FILENO);
+        bool m_editing = false;
+        bool m_quit = false;
+        linenoiseState m_prompt {};
+        char m_prompt_buf[1024] {};
+        std::string m_pending_input;
+        bool m_input_closed = false;
+
+        /* main() seizes the child while it's stopped short of exec, let it run up to the exec */
+        void wait_for_exec() {
+            int wait_status;
+            while (waitpid(m_pid, &wait_status, 0) > 0 && WIFSTOPPED(wait_status)
+                   && wait_status >> 16 != PTRACE_EVENT_EXEC) {
+                ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
+            }
+        }
+
+        /* one poll() over the terminal, SIGCHLD/SIGINT through a signalfd and a pidfd for the inferior
+           going away, so commands keep being read while it runs */
+        void event_loop() {
+            sigset_t mask;
+            sigemptyset(&mask);
+            sigaddset(&mask, SIGCHLD);
+            sigaddset(&mask, SIGINT);
+            sigprocmask(SIG_BLOCK, &mask, nullptr);
+            int sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+            int pid_fd = m_core ? -1 : static_cast<int>(syscall(SYS_pidfd_open, m_pid, 0));
+
+            start_prompt();
+            while (!m_quit) {
+                pollfd fds[] {
+                    {sig_fd, POLLIN, 0},
+                    {pid_fd, POLLIN, 0},
+                    {m_editing ? STDIN_FILENO : -1, POLLIN, 0},
+                };
+                if (poll(fds, std::size(fds), -1) < 0) {
+                    continue;
+                }
+
+                if (fds[0].revents || fds[1].revents) {
+                    handle_inferior_events(sig_fd);
+                    //pidfd stays readable once the process is gone
+                    if (m_exited && pid_fd >= 0) {
+                        close(pid_fd);
+                        pid_fd = -1;
+                    }
+                }
+                if (fds[2].revents) {
+                    read_input();
+                }
+            }
+
+            if (m_editing && m_tty) {
+                linenoiseEditStop(&m_prompt);
+            }
+            close(sig_fd);
+            if (pid_fd >= 0) {
+                close(pid_fd);
+            }
+        }
+
+        void handle_inferior_events(int sig_fd) {
+            signalfd_siginfo info;
+            bool sigint = false;
+            while (read(sig_fd, &info, sizeof(info)) == sizeof(info)) {
+                sigint |= info.ssi_signo == SIGINT;
+            }
+            //^C during a foreground continue. the inferior usually gets the SIGINT as well, but it may ignore it
+            if (sigint && m_running && m_foreground) {
+                interrupt();
+            }
+
+            //reap whether or not we think it's running, a stopped inferior can still be SIGKILLed
+            bool hidden = false;
+            termios raw {};
+            int wait_status;
+            while (!m_core && !m_exited && waitpid(m_pid, &wait_status, WNOHANG) > 0) {
+                if (m_editing && m_tty && !hidden) {
+                    //linenoise's raw mode clears OPOST and "\n" would stop returning to column 0, so turn
+                    //output processing back on while printing. unlike linenoiseEditStop/Start this keeps
+                    //whatever has been typed so far
+                    linenoiseHide(&m_prompt);
+                    tcgetattr(STDIN_FILENO, &raw);
+                    auto cooked = raw;
+                    cooked.c_oflag |= OPOST | ONLCR;
+                    tcsetattr(STDIN_FILENO, TCSADRAIN, &cooked);
+                    hidden = true;
+                }
+                handle_stop(wait_status);
+                if (std::exchange(m_at_rendezvous, false) || std::exchange(m_stale_interrupt, false)) {
+                    resume();
+                }
+            }
+
+            if (hidden) {
+                std::cout.flush();
+                tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+                linenoiseShow(&m_prompt);
+            }
+            if (!m_running) {
+                start_prompt();
+            }
+        }
+
+        void start_prompt() {
+            if (m_editing) {
+                return;
+            }
+            m_editing = true;
+            if (m_tty) {
+                linenoiseEditStart(&m_prompt, -1, -1, m_prompt_buf, sizeof(m_prompt_buf), "sandbg> ");
+            }
+            else {
+                std::cout << "sandbg> " << std::flush;
+                //lines already buffered up behind a foreground continue
+                run_pending_input();
+            }
+        }
+
+        void read_input() {
+            if (!m_tty) {
+                char buf[1024];
+                auto n = read(STDIN_FILENO, buf, sizeof(buf));
+                if (n <= 0) {
+                    m_input_closed = true;
+                }
+                else {
+                    m_pending_input.append(buf, n);
+                }
+                run_pending_input();
+                return;
+            }
+
+            char* line = linenoiseEditFeed(&m_prompt);
+            if (line == linenoiseEditMore) {
+                return;
+            }
+            linenoiseEditStop(&m_prompt);
+            m_editing = false;
+
+            if (line == nullptr) {
+                //^C never quits, with PTRACE_O_EXITKILL that would kill the inferior too. it interrupts
+                //a background run and otherwise just drops the line, only ^D/EOF (ENOENT) quits
+                if (errno == EAGAIN) {
+                    if (m_running) {
+                        interrupt();
+                    }
+                    start_prompt();
+                }
+                else {
+                    m_quit = true;
+                }
+                return;
+            }
+
+            handle_command(line);
+            linenoiseHistoryAdd(line);
+            linenoiseFree(line);
+            if (!(m_running && m_foreground)) {
+                start_prompt();
+            }
+        }
+
+        void run_pending_input() {
+            std::size_t end;
+            while (m_editing && (end = m_pending_input.find('\n')) != std::string::npos) {
+                auto line = m_pending_input.substr(0, end);
+                m_pending_input.erase(0, end + 1);
+                m_editing = false;
+                handle_command(line);
+                if (!(m_running && m_foreground)) {
+                    m_editing = true;
+                    std::cout << "sandbg> " << std::flush;
+                }
+            }
+            if (m_editing && m_input_closed) {
+                m_quit = true;
+            }
+        }
+
+        /* PTRACE_CONT (past a breakpoint at pc), the stop is picked up by the event loop */
+        void resume() {
+            //a signal/group-stop or exit during the step has already been reported, stay stopped
+            if (!step_over_breakpoint()) {
+                return;
+            }
+            ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
+            m_running = true;
+            //an interrupt swallowed by single_step() or the rendezvous breakpoint still needs delivering
+            if (m_interrupt_wanted) {
+                ptrace(PTRACE_INTERRUPT, m_pid, nullptr, nullptr);
+            }
+        }
+
+        void interrupt() {
+            if (!m_running) {
+                std::cerr << "Inferior is not running\n";
+                return;
+            }
+            ptrace(PTRACE_INTERRUPT, m_pid, nullptr, nullptr);
+            m_interrupt_wanted = true;
+        }
+
+        /* ptrace requests other than reading memory fail with ESRCH on a running tracee */
+        bool check_stopped() const {
+            if (m_core) {
+                std::cerr << "Not available when inspecting a core file\n";
+                return false;
+            }
+            if (m_exited) {
+                std::cerr << "Inferior has exited\n";
+                return false;
+            }
+            if (m_running) {
+                std::cerr << "Inferior is running, interrupt it first\n";
+                return false;
+            }
+            return true;
+        }
 
         void initialize_load_address() {
             if (m_elf.get_hdr().type == elf::et::dyn) {
-                std::ifstream map("/proc/" + std::to_string(m_pid) + "/maps");
-                std::string addr;
-                std::getline(map, addr, '-');
+                //first mapping of the executable itself
+                auto exe = std::filesystem::read_symlink("/proc/" + std::to_string(m_pid) + "/exe");
+                for (auto& region : sandbg::read_memory_map(m_pid)) {
+                    if (region.path == exe && region.offset == 0) {
+                        m_load_address = region.start;
+                        break;
+                    }
+                }
+            }
+        }
+
+        /* at the exec stop only the executable and ld.so are mapped and r_debug is still empty,
+           so look _r_debug/_dl_debug_state up in ld.so directly and let the breakpoint fill in the rest */
+        void initialize_modules() {
+            m_modules.emplace(m_program_name, Module{m_program_name, m_load_address, m_elf, m_dwarf});
+            m_module_order.push_back(m_program_name);
+
+            auto interp_base = sandbg::read_auxv(m_pid)[AT_BASE];
+            std::string interp;
+            for (auto& seg : m_elf.segments()) {
+                if (seg.get_hdr().type == elf::pt::interp) {
+                    interp = static_cast<const char*>(seg.data());
+                }
+            }
+            if (interp_base == 0 || interp.empty()) {
+                return;
+            }
+
+            Module ld {interp, interp_base};
+            auto r_debug = ld.find_symbol("_r_debug");
+            auto rendezvous = ld.find_symbol("_dl_debug_state");
+            m_modules.emplace(interp, std::move(ld));
+            m_module_order.push_back(interp);
+
+            if (r_debug && rendezvous) {
+                m_r_debug_address = *r_debug;
+                m_rendezvous_address = *rendezvous;
+                Breakpoint breakpoint {m_pid, static_cast<std::intptr_t>(m_rendezvous_address)};
+                breakpoint.enable();
+                m_breakpoints[m_rendezvous_address] = breakpoint;
+            }
+        }
 
-                m_load_address = std::stoi(addr, 0, 16);
+        /* a core has no link_map to walk, NT_FILE lists every mapped file instead. only files whose offset 0
+           mapping starts with an ELF header are objects, and for a shared library that mapping is its base */
+        void initialize_core_modules(const elf::elf& exe) {
+            m_modules.emplace(m_program_name, Module{m_program_name, m_load_address, exe, m_dwarf});
+            m_module_order.push_back(m_program_name);
+            auto exe_path = m_modules.at(m_program_name).get_mapped_path();
+
+            //NT_FILE is sorted by address, close enough to load order for symbol lookups
+            for (auto& file : m_core->get_files()) {
+                auto path = file.path == exe_path ? m_program_name : file.path;
+                if (!m_modules.contains(path)) {
+                    auto magic = m_core->read_memory(file.start);
+                    if (file.offset != 0 || !magic || std::memcmp(&*magic, ELFMAG, SELFMAG) != 0) {
+                        continue;
+                    }
+                    m_modules.emplace(path, Module{path, file.start});
+                    m_module_order.push_back(path);
+                }
+                m_modules.at(path).add_range(file.start, file.end);
             }
         }
 
+        /* called from _dl_debug_state, diff the link_map against what we have. objects that stay
+           loaded keep their Module so ELF/DWARF already parsed for them isn't thrown away */
+        void update_modules() {
+            auto objects = sandbg::read_link_map(m_pid, m_r_debug_address);
+            if (!objects) {
+                return;
+            }
+
+            std::vector<std::string> order;
+            std::map<std::string, uint64_t> current;
+            for (auto& object : *objects) {
+                //the executable's l_name is empty, keep it however it was launched (e.g. a bare relative name)
+                if (object.name.empty()) {
+                    if (current.emplace(m_program_name, m_load_address).second) {
+                        order.push_back(m_program_name);
+                    }
+                    continue;
+                }
+                //vdso has a name but no file behind it
+                if ((object.name[0] == '/' || object.name[0] == '.') && current.emplace(object.name, object.base).second) {
+                    order.push_back(object.name);
+                }
+            }
+
+            for (auto it = m_modules.begin(); it != m_modules.end();) {
+                auto found = current.find(it->first);
+                if (found != current.end() && found->second == it->second.get_base()) {
+                    ++it;
+                    continue;
+                }
+                remove_breakpoints_in(it->second);
+                std::cout << "Unloaded " << it->first << "\n";
+                it = m_modules.erase(it);
+            }
+
+            std::map<std::string, Module> added;
+            for (auto& path : order) {
+                if (!m_modules.contains(path)) {
+                    added.emplace(path, Module{path, current[path]});
+                }
+            }
+            m_module_order = std::move(order);
+            if (added.empty()) {
+                return;
+            }
+
+            //one maps read per load event gives every new module its address ranges up front
+            assign_module_ranges(added);
+            for (auto& path : m_module_order) {
+                if (auto it = added.find(path); it != added.end()) {
+                    std::cout << "Loaded " << path << " at 0x" << std::hex << it->second.get_base() << std::dec << "\n";
+                    resolve_pending_breakpoints(m_modules.emplace(path, std::move(it->second)).first->second);
+                }
+            }
+        }
+
+        /* match mappings to modules by path, so find_module() never has to open a file */
+        void assign_module_ranges(std::map<std::string, Module>& modules) const {
+            auto regions = sandbg::read_memory_map(m_pid);
+            for (auto& [path, module] : modules) {
+                for (auto& region : regions) {
+                    if (region.path == module.get_mapped_path()) {
+                        module.add_range(region.start, region.end);
+                    }
+                }
+            }
+        }
+
+        /* the code is gone, there's nothing to restore the original byte into. breakpoints set by
+           symbol go back to pending, so they come back when the library is loaded again */
+        void remove_breakpoints_in(Module& module) {
+            for (auto it = m_breakpoints.begin(); it != m_breakpoints.end();) {
+                if (module.contains(it->first)) {
+                    auto& symbol = it->second.get_symbol();
+                    std::cout << "Removed breakpoint at 0x" << std::hex << it->first << std::dec;
+                    if (!symbol.empty()) {
+                        std::cout << ", " << symbol << " pending until it is loaded again";
+                        m_pending_breakpoints.push_back(symbol);
+                    }
+                    std::cout << "\n";
+                    it = m_breakpoints.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
+        void resolve_pending_breakpoints(Module& module) {
+            for (auto it = m_pending_breakpoints.begin(); it != m_pending_breakpoints.end();) {
+                auto addr = module.find_symbol(*it);
+                if (!addr) {
+                    addr = module.find_symbol(*it, true);
+                }
+                if (addr) {
+                    set_breakpoint_at_address(*addr, *it);
+                    it = m_pending_breakpoints.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
+        Module* find_module(uint64_t addr) {
+            for (auto& path : m_module_order) {
+                auto& module = m_modules.at(path);
+                if (module.contains(addr)) {
+                    return &module;
+                }
+            }
+            return nullptr;
+        }
+
         uint64_t offset_load_address(const uint64_t addr) const {
             return addr - m_load_address;
         }
@@ -92,61 +580,144 @@ class Debugger {
             auto command = args[0];
 
             if (Helpers::is_prefix(command, "continue")) {
-                continue_execution();
+                if (check_stopped()) {
+                    continue_execution(args.size() > 1 && args[1] == "&");
+                }
+            }
+            else if (Helpers::is_prefix(command, "interrupt")) {
+                interrupt();
             }
             else if (Helpers::is_prefix(command, "break")) {
+                if (!check_stopped()) {
+                    return;
+                }
                 //TODO: Validation of address needs improvement
                 if(args[1][0] == '0' && args[1][1] == 'x') {
                     std::string addr {args[1], 2};
                     set_breakpoint_at_address(std::stol(addr, nullptr, 16));
                 }
+                else {
+                    set_breakpoint_at_symbol(args[1]);
+                }
             }
             else if (Helpers::is_prefix(command, "register")) {
+                if (!m_core && !check_stopped()) {
+                    return;
+                }
                 if (Helpers::is_prefix(args[1], "dump")) {
-                    sandbg::dump_registers(m_pid);
+                    if (m_core) {
+                        sandbg::dump_registers(m_core->get_registers());
+                    }
+                    else {
+                        sandbg::dump_registers(m_pid);
+                    }
                 }
                 else if (Helpers::is_prefix(args[1], "read")) {
-                    std::cout << sandbg::get_register_value(m_pid, sandbg::get_register_from_name(args[2])) << "\n";
+                    std::cout << get_register(sandbg::get_register_from_name(args[2])) << "\n";
                 }
-                else if (Helpers::is_prefix(args[1], "write")) {
+                else if (Helpers::is_prefix(args[1], "write") && check_stopped()) {
                     std::string val {args[3], 2};
                     sandbg::set_register_value(m_pid, sandbg::get_register_from_name(args[2]), std::stol(val, 0, 16));
                 }
             }
             else if (Helpers::is_prefix(command, "memory")) {
+                if (m_exited) {
+                    check_stopped();
+                    return;
+                }
                 std::string addr { args[2], 2};
 
                 if (Helpers::is_prefix(args[1], "read")) {
                     std::cout << read_memory(std::stol(addr, 0, 16)) << "\n";
                 }
-                else if (Helpers::is_prefix(args[1], "write")) {
+                else if (Helpers::is_prefix(args[1], "write") && check_stopped()) {
                     std::string val{args[3], 2};
                     write_memory(std::stol(addr, 0, 16), std::stol(args[3], 0, 16));
                 }
             }
+            else if (Helpers::is_prefix(command, "modules")) {
+                for (auto& path : m_module_order) {
+                    std::cout << "0x" << std::setfill('0') << std::setw(16) << std::hex << m_modules.at(path).get_base()
+                              << std::dec << " " << path << "\n";
+                }
+            }
+            else if (Helpers::is_prefix(command, "gcore")) {
+                if (args.size() < 2) {
+                    std::cerr << "Usage: gcore <file>\n";
+                    return;
+                }
+                if (!check_stopped()) {
+                    return;
+                }
+                //the pages breakpoints were poked into are COW'd and get dumped, put the real code back first
+                std::vector<Breakpoint*> enabled;
+                for (auto& [addr, breakpoint] : m_breakpoints) {
+                    if (breakpoint.is_enabled()) {
+                        breakpoint.disable();
+                        enabled.push_back(&breakpoint);
+                    }
+                }
+                try {
+                    auto stats = CoreDump{m_pid}.write(args[1]);
+                    std::cout << "Saved core file " << args[1] << " (" << std::dec << stats.segments << " segments, "
+                              << stats.bytes_dumped << " bytes dumped, " << stats.bytes_written << " bytes non-zero)\n";
+                }
+                catch (const std::exception& e) {
+                    std::cerr << e.what() << "\n";
+                }
+                for (auto breakpoint : enabled) {
+                    breakpoint->enable();
+                }
+            }
             else {
                 std::cerr << "Unknown command\n" ;
             }
         }
 
-        void continue_execution() {
-            step_over_breakpoint();
-            ptrace(PTRACE_CONT, m_pid, nullptr, nullptr);
-            wait_for_signal();
+        void continue_execution(bool background) {
+            m_foreground = !background;
+            resume();
+        }
+
+        uint64_t get_register(sandbg::reg r) const {
+            if (m_core) {
+                return sandbg::get_register_value(m_core->get_registers(), r);
+            }
+            return sandbg::get_register_value(m_pid, r);
         }
 
         std::intptr_t get_pc() const {
-            return static_cast<std::intptr_t>(get_register_value(m_pid, sandbg::reg::rip));
+            return static_cast<std::intptr_t>(get_register(sandbg::reg::rip));
         }
 
         void set_pc(const uint64_t pc) const {
             sandbg::set_register_value(m_pid, sandbg::reg::rip, pc);
         }
 
-        void wait_for_signal() const {
-            int wait_status;
-            constexpr auto options = 0;
-            waitpid(m_pid, &wait_status, options);
+        void handle_stop(int wait_status) {
+            m_running = false;
+
+            if (WIFEXITED(wait_status) || WIFSIGNALED(wait_status)) {
+                std::cout << "Process exited\n";
+                m_exited = true;
+                return;
+            }
+
+            //group-stop or PTRACE_INTERRUPT, there's no siginfo for these
+            if (wait_status >> 16 == PTRACE_EVENT_STOP) {
+                if (WSTOPSIG(wait_status) != SIGTRAP) {
+                    std::cout << "Stopped by signal " << WSTOPSIG(wait_status) << "\n";
+                    m_interrupt_wanted = false;
+                }
+                else if (std::exchange(m_interrupt_wanted, false)) {
+                    std::cout << "Interrupted at " << std::hex << get_pc() << std::dec << "\n";
+                    print_location(get_pc());
+                }
+                else {
+                    m_stale_interrupt = true;
+                }
+                return;
+            }
 
             auto siginfo = get_signal_info();
             switch (siginfo.si_signo) {
@@ -159,17 +730,24 @@ class Debugger {
                 default:
                     std::cerr << "Signal: " << siginfo.si_code << "\n";
             }
+            //anything reported to the user answers a pending interrupt
+            if (!m_at_rendezvous && !(siginfo.si_signo == SIGTRAP && siginfo.si_code == TRAP_TRACE)) {
+                m_interrupt_wanted = false;
+            }
         }
 
-        void handle_sigtrap(const siginfo_t siginfo) const {
+        void handle_sigtrap(const siginfo_t siginfo) {
             switch (siginfo.si_code) {
                 case TRAP_BRKPT:
                 case SI_KERNEL: {
                     set_pc(get_pc() - 1);
+                    if (m_rendezvous_address != 0 && static_cast<uint64_t>(get_pc()) == m_rendezvous_address) {
+                        m_at_rendezvous = true;
+                        update_modules();
+                        return;
+                    }
                     std::cout << "Hit breakpoint at " << std::hex << get_pc() << "\n";
-                    auto offset_pc = offset_load_address(get_pc());
-                    auto line_entry = get_line_entry_from_pc(get_pc());
-                    print_source(line_entry->file->path, line_entry->line);
+                    print_location(get_pc());
                     return;
 
                 }
@@ -181,7 +759,8 @@ class Debugger {
             }
         }
 
-        void step_over_breakpoint() {
+        /* false if something other than the step itself stopped the inferior */
+        bool step_over_breakpoint() {
 
 
             /* check if instruction is a breakpoint. NO OP otherwise */
@@ -189,10 +768,26 @@ class Debugger {
                 set_pc(get_pc());
                 Breakpoint& bp = m_breakpoints[get_pc()];
                 bp.disable();
-                ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, nullptr);
-                wait_for_signal();
-                bp.enable();
+                bool stepped = single_step();
+                if (!m_exited) {
+                    bp.enable();
+                }
+                return stepped;
             }
+            return true;
+        }
+
+        /* a PTRACE_INTERRUPT that lost the race to the last stop traps before the instruction runs, step
+           again. group-stops (SIGSTOP, SIGTSTP, ...) are event-stops too but get reported like any other stop */
+        bool single_step() {
+            int wait_status;
+            do {
+                ptrace(PTRACE_SINGLESTEP, m_pid, nullptr, nullptr);
+                waitpid(m_pid, &wait_status, 0);
+            } while (WIFSTOPPED(wait_status) && wait_status >> 16 == PTRACE_EVENT_STOP
+                     && WSTOPSIG(wait_status) == SIGTRAP);
+            handle_stop(wait_status);
+            return WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == SIGTRAP && wait_status >> 16 == 0;
         }
 
         dwarf::die get_function_from_pc(uint64_t pc) {
@@ -211,8 +806,31 @@ class Debugger {
             throw std::out_of_range("Cannot find function");
         }
 
-        dwarf::line_table::iterator get_line_entry_from_pc (uint64_t pc) const {
-            for (auto& cu : m_dwarf.compilation_units()) {
+        /* source if the module containing pc has line info, symbol+offset otherwise.
+           this is what pulls a library's DWARF in, only once we actually stop in it */
+        void print_location(uint64_t pc) {
+            auto module = find_module(pc);
+            if (!module) {
+                return;
+            }
+
+            if (auto dwarf = module->get_dwarf()) {
+                try {
+                    auto line_entry = get_line_entry_from_pc(*dwarf, pc - module->get_base());
+                    print_source(line_entry->file->path, line_entry->line);
+                    return;
+                }
+                catch (const std::out_of_range&) {}
+            }
+
+            if (auto sym = module->symbol_for(pc)) {
+                std::cout << "in " << sym->first << "+0x" << std::hex << sym->second << std::dec;
+            }
+            std::cout << " (" << module->get_path() << ")\n";
+        }
+
+        dwarf::line_table::iterator get_line_entry_from_pc (const dwarf::dwarf& dwarf, uint64_t pc) const {
+            for (auto& cu : dwarf.compilation_units()) {
                 if (dwarf::die_pc_range(cu.root()).contains(pc)) {
                     const dwarf::line_table& lt = cu.get_line_table();
                     const auto it = lt.find_address(pc);
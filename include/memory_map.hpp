@@ -0,0 +1,146 @@
+//
+// Created by Madhav Ramesh on 10/18/26.
+//
+
+#ifndef MEMORY_MAP_HPP
+#define MEMORY_MAP_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/uio.h>
+
+namespace sandbg {
+    /* one mapping from /proc/<pid>/maps (or smaps) */
+    struct memory_region {
+        uint64_t start;
+        uint64_t end;
+        bool readable;
+        bool writable;
+        bool executable;
+        bool shared;
+        uint64_t offset;
+        std::string path;
+        /* the rest is only filled in from smaps */
+        /* bytes of private (COW'd/anon) memory */
+        uint64_t anonymous;
+        /* VmFlags dd (MADV_DONTDUMP), io (device memory) and ht (hugetlbfs) */
+        bool dont_dump;
+        bool io;
+        bool hugetlb;
+
+        uint64_t size() const { return end - start; }
+
+        /* backed by a regular file rather than anon/[heap]/[stack]/... */
+        bool is_file_backed() const { return !path.empty() && path[0] == '/'; }
+    };
+
+    /* detailed = true reads smaps instead, which walks page tables and is much slower */
+    inline std::vector<memory_region> read_memory_map(pid_t pid, bool detailed = false) {
+        std::ifstream maps("/proc/" + std::to_string(pid) + (detailed ? "/smaps" : "/maps"));
+        std::vector<memory_region> regions;
+        std::string line;
+
+        while (std::getline(maps, line)) {
+            std::istringstream ss {line};
+            std::string range;
+            ss >> range;
+            if (range.empty()) {
+                continue;
+            }
+
+            //smaps attribute line, e.g. "Anonymous:  12 kB" or "VmFlags: rd wr mr mw me dd"
+            if (range.back() == ':') {
+                if (regions.empty()) {
+                    continue;
+                }
+                if (range == "Anonymous:") {
+                    uint64_t kb = 0;
+                    ss >> kb;
+                    regions.back().anonymous = kb * 1024;
+                }
+                else if (range == "VmFlags:") {
+                    std::string flag;
+                    while (ss >> flag) {
+                        regions.back().dont_dump |= flag == "dd";
+                        regions.back().io |= flag == "io";
+                        regions.back().hugetlb |= flag == "ht";
+                    }
+                }
+                continue;
+            }
+
+            //start-end perms offset dev inode [path]
+            std::string perms, offset, dev, inode;
+            ss >> perms >> offset >> dev >> inode;
+
+            memory_region region {};
+            auto dash = range.find('-');
+            region.start = std::stoull(range.substr(0, dash), nullptr, 16);
+            region.end = std::stoull(range.substr(dash + 1), nullptr, 16);
+            region.readable = perms[0] == 'r';
+            region.writable = perms[1] == 'w';
+            region.executable = perms[2] == 'x';
+            region.shared = perms[3] == 's';
+            region.offset = std::stoull(offset, nullptr, 16);
+
+            //path may contain spaces, take the remainder of the line
+            std::getline(ss >> std::ws, region.path);
+            regions.push_back(region);
+        }
+        return regions;
+    }
+
+    /* bulk read of len bytes at addr, one syscall instead of one PEEKDATA per word.
+       returns the number of bytes actually read (short on unmapped pages) */
+    inline std::size_t read_memory_block(pid_t pid, uint64_t addr, void* buf, std::size_t len) {
+        std::size_t done = 0;
+        while (done < len) {
+            iovec local {static_cast<char*>(buf) + done, len - done};
+            iovec remote {reinterpret_cast<void*>(addr + done), len - done};
+            auto n = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+            if (n <= 0) {
+                break;
+            }
+            done += n;
+        }
+        return done;
+    }
+
+    /* NUL terminated string from the inferior, e.g. link_map::l_name */
+    inline std::string read_string(pid_t pid, uint64_t addr, std::size_t max_len = 4096) {
+        std::string out;
+        char buf[256];
+
+        while (out.size() < max_len) {
+            auto n = read_memory_block(pid, addr + out.size(), buf, sizeof(buf));
+            if (n == 0) {
+                break;
+            }
+            auto nul = std::find(buf, buf + n, '\0');
+            out.append(buf, nul);
+            if (nul != buf + n) {
+                break;
+            }
+        }
+        return out;
+    }
+
+    /* a_type -> a_val from /proc/<pid>/auxv */
+    inline std::unordered_map<uint64_t, uint64_t> read_auxv(pid_t pid) {
+        std::ifstream auxv("/proc/" + std::to_string(pid) + "/auxv", std::ios::binary);
+        std::unordered_map<uint64_t, uint64_t> entries;
+        uint64_t entry[2];
+
+        while (auxv.read(reinterpret_cast<char*>(entry), sizeof(entry)) && entry[0] != 0) {
+            entries[entry[0]] = entry[1];
+        }
+        return entries;
+    }
+}
+
+#endif //MEMORY_MAP_HPP
@@ -0,0 +1,250 @@
+//
+// Created by Madhav Ramesh on 10/18/26.
+//
+
+#ifndef MODULE_HPP
+#define MODULE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <link.h>
+#include <unistd.h>
+
+#include <dwarf++.hh>
+#include <elf++.hh>
+
+#include "memory_map.hpp"
+
+/*
+ * An ELF object mapped into the inferior (the executable, ld.so or a shared library).
+ * ELF and DWARF are only loaded the first time something asks for them, so libraries we
+ * never stop in or look symbols up in cost nothing beyond their path and load bias.
+ */
+class Module {
+    public:
+        Module(std::string path, uint64_t base)
+        : m_path(std::move(path)), m_mapped_path(canonical_path(m_path)), m_base(base) {}
+
+        /* for objects that have already been loaded, e.g. the main executable */
+        Module(std::string path, uint64_t base, elf::elf elf, dwarf::dwarf dwarf)
+        : m_path(std::move(path)), m_mapped_path(canonical_path(m_path)), m_base(base),
+          m_elf(std::move(elf)), m_dwarf(std::move(dwarf)),
+          m_elf_loaded(true), m_dwarf_loaded(true), m_has_elf(true), m_has_dwarf(true) {}
+
+        const std::string& get_path() const { return m_path; }
+
+        /* symlinks resolved, as the object shows up in /proc/<pid>/maps */
+        const std::string& get_mapped_path() const { return m_mapped_path; }
+
+        /* [start, end) the object is mapped at, from maps or NT_FILE */
+        void add_range(uint64_t start, uint64_t end) { m_ranges.emplace_back(start, end); }
+
+        /* l_addr, difference between link-time and runtime addresses */
+        uint64_t get_base() const { return m_base; }
+
+        /* nullptr when the file can't be opened (e.g. the vdso) */
+        const elf::elf* get_elf() {
+            if (!m_elf_loaded) {
+                m_elf_loaded = true;
+                auto fd = open(m_path.c_str(), O_RDONLY);
+                if (fd >= 0) {
+                    //the loader closes fd itself once the file is mapped, only close it if mapping failed
+                    std::shared_ptr<elf::loader> loader;
+                    try {
+                        loader = elf::create_mmap_loader(fd);
+                    }
+                    catch (const std::exception&) {
+                        close(fd);
+                    }
+                    if (loader) {
+                        try {
+                            m_elf = elf::elf{loader};
+                            m_has_elf = true;
+                        }
+                        catch (const std::exception&) {}
+                    }
+                }
+            }
+            return m_has_elf ? &m_elf : nullptr;
+        }
+
+        /* nullptr when the object has no debug info */
+        const dwarf::dwarf* get_dwarf() {
+            if (!m_dwarf_loaded) {
+                m_dwarf_loaded = true;
+                if (get_elf()) {
+                    try {
+                        m_dwarf = dwarf::dwarf{dwarf::elf::create_loader(m_elf)};
+                        m_has_dwarf = true;
+                    }
+                    catch (const std::exception&) {}
+                }
+            }
+            return m_has_dwarf ? &m_dwarf : nullptr;
+        }
+
+        /* whether a runtime address belongs to us. never opens the file, without known
+           ranges only an ELF that's already loaded gets its PT_LOAD segments checked */
+        bool contains(uint64_t addr) const {
+            if (!m_ranges.empty()) {
+                return std::any_of(m_ranges.begin(), m_ranges.end(),
+                                   [addr](auto&& r) { return addr >= r.first && addr < r.second; });
+            }
+            if (!m_has_elf) {
+                return false;
+            }
+            for (auto& seg : m_elf.segments()) {
+                auto& hdr = seg.get_hdr();
+                if (hdr.type == elf::pt::load
+                    && addr >= m_base + hdr.vaddr && addr < m_base + hdr.vaddr + hdr.memsz) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /* runtime address of a function/object symbol from .symtab or .dynsym. only global/weak
+           definitions unless include_local, so a static helper doesn't shadow an exported name */
+        std::optional<uint64_t> find_symbol(const std::string& name, bool include_local = false) {
+            load_symbols();
+            auto it = m_symbols_by_name.find(name);
+            if (it == m_symbols_by_name.end() && include_local) {
+                it = m_local_symbols_by_name.find(name);
+                if (it == m_local_symbols_by_name.end()) {
+                    return std::nullopt;
+                }
+            }
+            else if (it == m_symbols_by_name.end()) {
+                return std::nullopt;
+            }
+            return m_base + m_symbols[it->second].value;
+        }
+
+        /* closest symbol at or below a runtime address, as (name, offset) */
+        std::optional<std::pair<std::string, uint64_t>> symbol_for(uint64_t addr) {
+            load_symbols();
+            auto it = std::upper_bound(m_symbols.begin(), m_symbols.end(), addr - m_base,
+                                       [](uint64_t a, auto&& sym) { return a < sym.value; });
+            if (it == m_symbols.begin()) {
+                return std::nullopt;
+            }
+            --it;
+            if (it->size != 0 && addr - m_base >= it->value + it->size) {
+                return std::nullopt;
+            }
+            return std::make_pair(it->name, addr - m_base - it->value);
+        }
+
+    private:
+        struct symbol {
+            std::string name;
+            uint64_t value;
+            uint64_t size;
+            elf::stb binding;
+        };
+
+        std::string m_path;
+        std::string m_mapped_path;
+        uint64_t m_base;
+        std::vector<std::pair<uint64_t, uint64_t>> m_ranges;
+
+        elf::elf m_elf;
+        dwarf::dwarf m_dwarf;
+        bool m_elf_loaded = false;
+        bool m_dwarf_loaded = false;
+        bool m_has_elf = false;
+        bool m_has_dwarf = false;
+
+        /* sorted by value, built on first lookup */
+        std::vector<symbol> m_symbols;
+        std::unordered_map<std::string, std::size_t> m_symbols_by_name;
+        std::unordered_map<std::string, std::size_t> m_local_symbols_by_name;
+        bool m_symbols_loaded = false;
+
+        static std::string canonical_path(const std::string& path) {
+            std::error_code ec;
+            auto canonical = std::filesystem::weakly_canonical(path, ec);
+            return ec ? path : canonical.string();
+        }
+
+        void load_symbols() {
+            if (m_symbols_loaded) {
+                return;
+            }
+            m_symbols_loaded = true;
+            if (!get_elf()) {
+                return;
+            }
+
+            for (auto& sec : m_elf.sections()) {
+                auto type = sec.get_hdr().type;
+                if (type != elf::sht::symtab && type != elf::sht::dynsym) {
+                    continue;
+                }
+                for (auto sym : sec.as_symtab()) {
+                    auto& data = sym.get_data();
+                    if (data.shnxd == elf::shn::undef || data.value == 0
+                        || (data.type() != elf::stt::func && data.type() != elf::stt::object)) {
+                        continue;
+                    }
+                    m_symbols.push_back({sym.get_name(), data.value, data.size, data.binding()});
+                }
+            }
+
+            std::sort(m_symbols.begin(), m_symbols.end(),
+                      [](auto&& a, auto&& b) { return a.value < b.value; });
+            for (std::size_t i = 0; i < m_symbols.size(); ++i) {
+                auto& sym = m_symbols[i];
+                if (sym.binding == elf::stb::local) {
+                    m_local_symbols_by_name.emplace(sym.name, i);
+                    continue;
+                }
+                //.symtab and .dynsym overlap, a global definition beats a weak one
+                auto [it, inserted] = m_symbols_by_name.emplace(sym.name, i);
+                if (!inserted && m_symbols[it->second].binding == elf::stb::weak && sym.binding == elf::stb::global) {
+                    it->second = i;
+                }
+            }
+        }
+};
+
+namespace sandbg {
+    /* one link_map entry, name is empty for the main executable */
+    struct loaded_object {
+        std::string name;
+        uint64_t base;
+    };
+
+    /* walks r_debug.r_map in the inferior. nullopt while the dynamic linker is
+       half way through adding/removing objects and the list can't be trusted */
+    inline std::optional<std::vector<loaded_object>> read_link_map(pid_t pid, uint64_t r_debug_addr) {
+        r_debug rd {};
+        if (read_memory_block(pid, r_debug_addr, &rd, sizeof(rd)) != sizeof(rd)
+            || rd.r_state != r_debug::RT_CONSISTENT) {
+            return std::nullopt;
+        }
+
+        std::vector<loaded_object> objects;
+        auto addr = reinterpret_cast<uint64_t>(rd.r_map);
+        while (addr != 0) {
+            link_map lm {};
+            if (read_memory_block(pid, addr, &lm, sizeof(lm)) != sizeof(lm)) {
+                break;
+            }
+            auto name = lm.l_name ? read_string(pid, reinterpret_cast<uint64_t>(lm.l_name)) : std::string{};
+            objects.push_back({name, lm.l_addr});
+            addr = reinterpret_cast<uint64_t>(lm.l_next);
+        }
+        return objects;
+    }
+}
+
+#endif //MODULE_HPP
@@ -65,16 +65,20 @@ namespace sandbg {
         }
     };
 
-    static uint64_t get_register_value(pid_t pid, reg r) {
-        user_regs_struct regs;
-        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
-
+    /* from a saved register set, e.g. NT_PRSTATUS in a core file */
+    static uint64_t get_register_value(const user_regs_struct& regs, reg r) {
         const auto it = std::find_if(std::begin(g_register_descriptors),
                                 std::end(g_register_descriptors),
                                 [r](auto&& reg_desc) { return reg_desc.r == r; }
             );
         //Euh!!TODO: handle case for when it is end()
-        return *(reinterpret_cast<uint64_t*>(&regs) + (it - std::begin(g_register_descriptors)));
+        return *(reinterpret_cast<const uint64_t*>(&regs) + (it - std::begin(g_register_descriptors)));
+    }
+
+    static uint64_t get_register_value(pid_t pid, reg r) {
+        user_regs_struct regs;
+        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+        return get_register_value(regs, r);
     }
 
     static void set_register_value(pid_t pid, reg r, const uint64_t value) {
@@ -116,12 +120,18 @@ namespace sandbg {
         return it->r;
     }
 
-    static void dump_registers(pid_t pid) {
+    static void dump_registers(const user_regs_struct& regs) {
         for(auto& reg : g_register_descriptors) {
             std::cout << reg.name << " 0x" << std::setfill('0') << std::setw(16)
-            << std::hex << get_register_value(pid, reg.r) << "\n";
+            << std::hex << get_register_value(regs, reg.r) << "\n";
         }
     }
+
+    static void dump_registers(pid_t pid) {
+        user_regs_struct regs;
+        ptrace(PTRACE_GETREGS, pid, nullptr, &regs);
+        dump_registers(regs);
+    }
 }
 
 #endif //REGISTERS_HPP
@@ -1,7 +1,9 @@
 #include <iostream>
+#include <csignal>
 #include <unistd.h>
 #include <sys/ptrace.h>
 #include <sys/personality.h>
+#include <sys/wait.h>
 
 #include "include/debugger.hpp"
 
@@ -13,6 +15,14 @@ int main(int argc, char *argv[])
     }
 
     auto prog = argv[1];
+
+    //sandbg <program> --core <file> inspects a core offline instead of launching
+    if (argc >= 4 && std::string{argv[2]} == "--core") {
+        Debugger dbg {prog, argv[3]};
+        dbg.run();
+        return 0;
+    }
+
     auto pid = fork();
 
     switch (pid) {
@@ -22,13 +32,18 @@ int main(int argc, char *argv[])
 
         case 0:
             personality(ADDR_NO_RANDOMIZE);
-            ptrace(PTRACE_TRACEME, pid, nullptr, nullptr);
+            //stop short of exec so the parent can PTRACE_SEIZE us, TRACEME doesn't allow PTRACE_INTERRUPT
+            raise(SIGSTOP);
             execl(prog, prog, nullptr);
             std::cerr << "Exec returned error\n";
             exit(EXIT_FAILURE);
 
         default:
             std::cout << "In the parent process. Child pid = " << pid << "\n";
+            int wait_status;
+            waitpid(pid, &wait_status, WUNTRACED);
+            ptrace(PTRACE_SEIZE, pid, nullptr, PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+            kill(pid, SIGCONT);
             Debugger dbg {prog, pid};
             dbg.run();
     }